@@ -10,6 +10,25 @@
  */ 
 bool DEBUG = false;
 
+/********  PULSE DIAGNOSTICS  ********
+ * Set truthy to profile the step pulse train on the board itself.
+ * Requires (Mega 2560 only):
+ *  A jumper wire from PULSE_PIN to PULSE_CAPTURE_PIN, and the LCD
+ *  RS wire moved off of pin 48 (see rs_PIN below).
+ * While coasting at the set speed, every PULSE_DIAG_REPORT_MILLIS the
+ * effective steps/sec, the earliest and latest step vs. the set speed, gaps
+ * (intervals over 2x the set speed) and the longest pass through the main
+ * loop are written to Serial at 115200 baud, and a summary to the second
+ * row of the LCD after the direction marker (< or >).
+ * Notes:
+ *  The reports themselves affect pulse timing.  Serial output is split
+ *  so it never blocks, but the serial transmit interrupt still fires for
+ *  every character and can delay the stepper's timer interrupt, and the
+ *  LCD write blocks the main loop for a few millis.  Expect slightly
+ *  more jitter in the windows where a report is being sent.
+ */
+#define PULSE_DIAGNOSTICS false
+
 // Pins used for rotary encoder.  Depending on your board you 
 // might need to specifically use these two pins for interrupts.  Change with caution.
 // See: https://www.arduino.cc/reference/en/language/functions/external-interrupts/attachinterrupt/
@@ -24,6 +43,10 @@ bool DEBUG = false;
 #define DIRECTION_PIN 22
 #define ENABLE_PIN 24
 
+// Pin used for the pulse diagnostics loopback.  Must be 48, it's the Timer5
+// input capture pin (ICP5) and can't be remapped.  Only used when PULSE_DIAGNOSTICS is on.
+#define PULSE_CAPTURE_PIN 48
+
 // Pins used for direction signals
 #define MOVELEFT_PIN 9
 #define MOVERIGHT_PIN 10
@@ -32,7 +55,7 @@ bool DEBUG = false;
 #define RAPID_PIN 11
 
 // LCD Pins
-#define rs_PIN 48
+#define rs_PIN 48 // Move to a free pin (e.g. 47) when PULSE_DIAGNOSTICS is on.
 #define lcdEnable_PIN 49
 #define d4_PIN 50
 #define d5_PIN 51
@@ -69,6 +92,16 @@ const unsigned long SWITCHREADDELAY = 20;
 // Your increments are off by a multiple of N
 int encoderStepsPerDetent = 4;
 
+// Pulse diagnostics report interval in millis
+const unsigned long PULSE_DIAG_REPORT_MILLIS = 1000;
+
+// Pulse diagnostics histogram, PULSE_DIAG_BINS bins of 2^PULSE_DIAG_BIN_SHIFT
+// timer ticks (0.5us each), centered on the set speed.  A power of two keeps
+// division out of the capture interrupt.  16 bins of 4us cover -32us to +32us,
+// the end bins catch everything beyond.  Keep the bin count even.
+#define PULSE_DIAG_BINS 16
+#define PULSE_DIAG_BIN_SHIFT 3
+
 
 
 
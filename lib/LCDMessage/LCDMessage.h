@@ -80,6 +80,29 @@ class LCDMessage {
             }
             this->writeLCD();
         }
-        
+
+        // Pulse diagnostics summary on the second row, behind a compact
+        // direction marker so the table direction stays visible.
+        // The full arrows return on the next printArrows.  Never covers "STOPPED".
+        void diagnosticsMessage(unsigned long jitterMicros, unsigned int gaps, unsigned long stepsPerSec) {
+            String marker;
+            switch (this->directionState) {
+                case LOW:
+                    marker = ">";
+                    break;
+                case HIGH:
+                    marker = "<";
+                    break;
+                default:
+                    return;
+            }
+
+            String diagStr = marker + "J" + String(jitterMicros) + " G" + String(gaps) + " S" + String(stepsPerSec) + "        ";
+            this->line2String = diagStr.substring(0, 16);
+
+            lcd.setCursor(0,1); // Second Row
+            lcd.print(this->line2String);
+        }
+
 };
 
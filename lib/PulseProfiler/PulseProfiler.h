@@ -0,0 +1,287 @@
+/**
+ * Pulse profiler for diagnosing missed steps and RPM inaccuracies
+ * ---------------------------------------------------------------
+ *
+ * Serial logging can't see the pulse train, and an external tachometer
+ * can't tell you when or why a step was late.  With PULSE_PIN jumpered
+ * to PULSE_CAPTURE_PIN, every rising edge is timestamped by the Timer5
+ * input capture hardware at 0.5us resolution, so loop() latency and
+ * interrupt latency don't skew the measurement.
+ *
+ * Each report window collects, in fixed RAM:
+ *   - a histogram of step interval deviation from the speed set on the stepper
+ *   - the earliest and latest step vs. the set speed (max jitter)
+ *   - gaps, intervals more than twice the set speed (stalls, missed steps)
+ *   - effective steps/sec actually sent to the driver
+ *   - the longest pass through loop(), to line up with the above
+ *
+ * Steps are only scored while coasting at the set speed.  FastAccelStepper
+ * plans ahead of the pin, so when it starts coasting the queue still holds
+ * ramp steps; scoring waits until the position queued at that moment has
+ * been stepped out.  A speed change silently starts a new window.
+ *
+ * Reports are sent one part per loop, and only when the part fits in the
+ * Serial transmit buffer, so writing them never blocks loop().
+ */
+
+#if !defined(__AVR_ATmega2560__)
+#error "PULSE_DIAGNOSTICS needs Timer5 input capture (ICP5), only available on the Mega 2560."
+#endif
+
+#if rs_PIN == PULSE_CAPTURE_PIN
+#error "PULSE_CAPTURE_PIN is used by the LCD, move rs_PIN to a free pin."
+#endif
+
+class PulseProfiler {
+    private:
+        // Timer5 runs at clk/8, 2 ticks per micro at 16MHz
+        const unsigned long ticksPerSec = F_CPU / 8;
+        const unsigned long ticksPerMicro = F_CPU / 8 / 1000000;
+
+        // Report parts, summary first then the histogram 8 bins at a time.
+        // Each part is under 64 chars, the size of the Serial transmit buffer.
+        const int binsPerPart = 8;
+        const int reportParts = 1 + (PULSE_DIAG_BINS + 7) / 8;
+        const int partChars = 60;
+
+        // Capture state, shared with the ISRs
+        volatile unsigned int overflows = 0; // High word of the 32-bit timestamp
+        volatile unsigned long lastCapture = 0;
+        volatile bool armed = false; // False until the first edge after scoring starts
+
+        // Set speed in timer ticks, 0 when not scoring (nothing is recorded)
+        volatile unsigned long expectedTicks = 0;
+        volatile unsigned long gapTicks = 0;
+
+        // Current window, written by the capture ISR
+        volatile unsigned int binCounts[PULSE_DIAG_BINS];
+        volatile unsigned long stepCount = 0;
+        volatile unsigned long tickSum = 0;
+        volatile unsigned long minTicks = 0xFFFFFFFF;
+        volatile unsigned long maxTicks = 0;
+        volatile unsigned int gapCount = 0;
+
+        // Main loop state
+        unsigned long targetMicrosPerStep = 0;
+        bool settling = false; // Coasting, but queued ramp steps are still going out
+        long settlePosition = 0;
+        unsigned long lastReportMillis = 0;
+        unsigned long lastLoopMicros = 0;
+        unsigned long maxLoopMicros = 0;
+
+        // Last closed window, waiting to be sent
+        int nextPart = 0; // 0 = nothing pending
+        unsigned long reportTarget = 0;
+        unsigned long reportStepsPerSec = 0;
+        unsigned long reportEarlyMicros = 0;
+        unsigned long reportLateMicros = 0;
+        unsigned int reportGaps = 0;
+        unsigned long reportLoopMicros = 0;
+        unsigned int reportBins[PULSE_DIAG_BINS];
+
+        // Call with interrupts off
+        void clearWindow() {
+            for (int i = 0; i < PULSE_DIAG_BINS; i++) {
+                this->binCounts[i] = 0;
+            }
+            this->stepCount = 0;
+            this->tickSum = 0;
+            this->minTicks = 0xFFFFFFFF;
+            this->maxTicks = 0;
+            this->gapCount = 0;
+        }
+
+        // Start (or stop, with 0) scoring against a new speed
+        void startWindow(unsigned long target) {
+            noInterrupts();
+            this->expectedTicks = target * this->ticksPerMicro;
+            this->gapTicks = this->expectedTicks * 2;
+            this->armed = false; // Don't measure across the change
+            this->clearWindow();
+            interrupts();
+
+            this->lastReportMillis = millis();
+            this->maxLoopMicros = 0;
+        }
+
+        // Runs in the capture ISR, shifts and compares only.
+        void record(unsigned long interval) {
+            this->stepCount++;
+            this->tickSum += interval;
+
+            if (interval < this->minTicks) {
+                this->minTicks = interval;
+            }
+            if (interval > this->maxTicks) {
+                this->maxTicks = interval;
+            }
+            if (interval > this->gapTicks) {
+                this->gapCount++;
+            }
+
+            // Bin i covers deviations of [(i - BINS/2), (i - BINS/2 + 1)) bin widths,
+            // the end bins catch everything beyond.
+            long offset = (long)(interval - this->expectedTicks) + ((long)(PULSE_DIAG_BINS / 2) << PULSE_DIAG_BIN_SHIFT);
+            unsigned int bin = 0;
+            if (offset > 0) {
+                unsigned long binIndex = (unsigned long)offset >> PULSE_DIAG_BIN_SHIFT;
+                bin = (binIndex >= PULSE_DIAG_BINS) ? PULSE_DIAG_BINS - 1 : binIndex;
+            }
+            if (this->binCounts[bin] != 0xFFFF) { // Saturate instead of wrapping
+                this->binCounts[bin]++;
+            }
+        }
+
+        // Close the window and queue it for sending.  Replaces any unsent parts.
+        void closeWindow() {
+            // Snapshot and clear together so the ISR can't split the window
+            noInterrupts();
+            unsigned long steps = this->stepCount;
+            unsigned long ticks = this->tickSum;
+            unsigned long minInterval = this->minTicks;
+            unsigned long maxInterval = this->maxTicks;
+            unsigned long expected = this->expectedTicks;
+            this->reportGaps = this->gapCount;
+            for (int i = 0; i < PULSE_DIAG_BINS; i++) {
+                this->reportBins[i] = this->binCounts[i];
+            }
+            this->clearWindow();
+            interrupts();
+
+            this->reportLoopMicros = this->maxLoopMicros;
+            this->maxLoopMicros = 0;
+
+            if (steps == 0 || expected == 0) { // Idle, nothing to report
+                return;
+            }
+
+            this->reportTarget = this->targetMicrosPerStep;
+            this->reportStepsPerSec = ((float)steps * this->ticksPerSec) / ticks;
+            this->reportEarlyMicros = (minInterval < expected) ? (expected - minInterval) / this->ticksPerMicro : 0;
+            this->reportLateMicros = (maxInterval > expected) ? (maxInterval - expected) / this->ticksPerMicro : 0;
+            this->nextPart = 1;
+        }
+
+        // Send the next report part if it fits in the transmit buffer
+        void sendPart() {
+            if (this->nextPart == 0 || Serial.availableForWrite() < this->partChars) {
+                return;
+            }
+
+            if (this->nextPart == 1) {
+                // PULSE,target us/step,steps/sec,earliest us,latest us,gaps,max loop us
+                Serial.print("PULSE,");
+                Serial.print(this->reportTarget);
+                Serial.print(",");
+                Serial.print(this->reportStepsPerSec);
+                Serial.print(",-");
+                Serial.print(this->reportEarlyMicros);
+                Serial.print(",+");
+                Serial.print(this->reportLateMicros);
+                Serial.print(",");
+                Serial.print(this->reportGaps);
+                Serial.print(",");
+                Serial.println(this->reportLoopMicros);
+
+                lcdMessage.diagnosticsMessage(max(this->reportEarlyMicros, this->reportLateMicros), this->reportGaps, this->reportStepsPerSec);
+            }
+            else {
+                // HIST,first bin,counts...
+                int first = (this->nextPart - 2) * this->binsPerPart;
+                int last = min(first + this->binsPerPart, PULSE_DIAG_BINS);
+                Serial.print("HIST,");
+                Serial.print(first);
+                for (int i = first; i < last; i++) {
+                    Serial.print(",");
+                    Serial.print(this->reportBins[i]);
+                }
+                Serial.println();
+            }
+
+            this->nextPart = (this->nextPart < this->reportParts) ? this->nextPart + 1 : 0;
+            this->lastLoopMicros = micros(); // Don't count the report against the next loop
+        }
+
+    public:
+        // Constructor
+        PulseProfiler() {
+            this->clearWindow();
+        }
+
+        void begin() {
+            pinModeFast(PULSE_CAPTURE_PIN, INPUT);
+
+            noInterrupts();
+            TCCR5A = 0; // Normal mode, output compare pins disconnected
+            TCCR5B = _BV(ICNC5) | _BV(ICES5) | _BV(CS51); // Noise canceler, rising edge, clk/8
+            TCNT5 = 0;
+            TIFR5 = _BV(ICF5) | _BV(TOV5); // Clear anything pending
+            TIMSK5 = _BV(ICIE5) | _BV(TOIE5);
+            interrupts();
+
+            this->lastReportMillis = millis();
+            this->lastLoopMicros = micros();
+        }
+
+        // Timer5 input capture ISR
+        void capture() {
+            unsigned int captured = ICR5;
+            unsigned int high = this->overflows;
+
+            // An overflow still pending with a low capture value happened before the edge
+            if ((TIFR5 & _BV(TOV5)) && captured < 0x8000) {
+                high++;
+            }
+            unsigned long now = ((unsigned long)high << 16) | captured;
+
+            if (this->armed && this->expectedTicks) {
+                this->record(now - this->lastCapture);
+            }
+            this->lastCapture = now;
+            this->armed = true;
+        }
+
+        // Timer5 overflow ISR
+        void overflow() {
+            this->overflows++;
+        }
+
+        // Call on every loop
+        void update() {
+            unsigned long nowMicros = micros();
+            unsigned long loopMicros = nowMicros - this->lastLoopMicros;
+            this->lastLoopMicros = nowMicros;
+            if (loopMicros > this->maxLoopMicros) {
+                this->maxLoopMicros = loopMicros;
+            }
+
+            // Compare against the speed actually set on the stepper, normal or rapid
+            unsigned long target = 0;
+            if (stepper && (stepper->rampState() & RAMP_STATE_MASK) == RAMP_STATE_COAST) {
+                target = stepper->getSpeedInUs();
+            }
+
+            // Speed changed, stop scoring until the queued ramp steps are out.
+            // No report here, spinning the encoder would flood Serial.
+            if (target != this->targetMicrosPerStep) {
+                this->startWindow(0);
+                this->targetMicrosPerStep = target;
+                this->settling = (target != 0);
+                if (this->settling) {
+                    this->settlePosition = stepper->getPositionAfterCommandsCompleted();
+                }
+            }
+            else if (this->settling) { // Always runs forward, position only climbs
+                if ((stepper->getCurrentPosition() - this->settlePosition) >= 0) {
+                    this->settling = false;
+                    this->startWindow(target);
+                }
+            }
+            else if ((millis() - this->lastReportMillis) > PULSE_DIAG_REPORT_MILLIS) {
+                this->lastReportMillis += PULSE_DIAG_REPORT_MILLIS;
+                this->closeWindow();
+            }
+
+            this->sendPart();
+        }
+};
@@ -41,8 +41,25 @@ MomentarySwitch rapidButton(DEBOUNCEMILLISMOMENTARY, 0);
 Encoder rotaryEncoder(rotaryPinA, rotaryPinB);
 #include <RotaryEncoder.h> // Custom rotary encoder controller.  
 
+#if PULSE_DIAGNOSTICS
+// On-board step pulse jitter and rate profiler, see configuration.h for wiring.
+#include <PulseProfiler.h>
+PulseProfiler pulseProfiler;
+
+ISR(TIMER5_CAPT_vect) {
+    pulseProfiler.capture();
+}
+
+ISR(TIMER5_OVF_vect) {
+    pulseProfiler.overflow();
+}
+#endif
+
 void setup() {
-    if (DEBUG) { // Log Events to Serial Monitor
+    if (PULSE_DIAGNOSTICS) { // Faster, so reports block loop() as little as possible
+        Serial.begin(115200);
+    }
+    else if (DEBUG) { // Log Events to Serial Monitor
         Serial.begin(9600);  
     }
     
@@ -71,6 +88,10 @@ void setup() {
     rapidButton.begin(RAPID_PIN);
     encoderButton.begin(rotaryMomentaryPin);
 
+#if PULSE_DIAGNOSTICS
+    pulseProfiler.begin();
+#endif
+
     // Everything is set up, let's go!
     lcdMessage.welcomeMessage();
 }
@@ -82,4 +103,8 @@ void loop() {
     encoderButton.read();
 
     readRotaryEncoder(); // Abstraction to simplify encoder readings and translation to speed/events.
+
+#if PULSE_DIAGNOSTICS
+    pulseProfiler.update();
+#endif
 }